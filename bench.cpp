@@ -0,0 +1,110 @@
+#include <thread>
+#include <iterator>
+#include <cstring>
+#include "proto.h"
+
+// 并行子流扩展性测试：依次以不同的 Flows 运行一次完整传输，汇总各次的有效吞吐量
+// 需与 receiver.exe、sender.exe、config.cfg 放在同一目录下运行，测试期间临时改写 config.cfg 中的 Flows，结束后恢复
+// 用法：bench.exe [flows...]，缺省依次测试 1 2 4 8 16
+
+// 读取整个文件，文件不存在时返回空串
+string readFile(const string &path)
+{
+    ifstream file(path, ios::binary);
+    return string(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+}
+
+// 把配置文本中的 Flows 一行替换为 flowCount，没有该行时追加
+string setFlows(const string &configText, int flowCount)
+{
+    istringstream in(configText);
+    ostringstream out;
+    string line;
+    bool found = false;
+    while (getline(in, line))
+    {
+        if (line.compare(0, 6, "Flows=") == 0)
+        {
+            line = "Flows=" + to_string(flowCount);
+            found = true;
+        }
+        out << line << "\n";
+    }
+    if (!found)
+        out << "Flows=" << flowCount << "\n";
+    return out.str();
+}
+
+int main(int argc, char *argv[])
+{
+    vector<int> flowList;
+    for (int i = 1; i < argc; ++i)
+        flowList.push_back(atoi(argv[i]));
+    if (flowList.empty())
+        flowList = {1, 2, 4, 8, 16};
+
+    string configText = readFile("config.cfg");
+    if (configText.empty())
+    {
+        cerr << "can't open config.cfg" << endl;
+        return 1;
+    }
+    auto config = loadConfig("config.cfg");
+    string inputPath = config["InputPath"];
+    string outputPath = config["OutputPath"];
+    string input = readFile(inputPath);
+
+    vector<double> goodputs(flowList.size(), 0);
+    vector<bool> matches(flowList.size(), false);
+    for (size_t k = 0; k < flowList.size(); ++k)
+    {
+        if (flowList[k] < 1)
+        {
+            cerr << "Invalid flows " << flowList[k] << ", expected a positive integer.\n";
+            continue;
+        }
+        ofstream("config.cfg", ios::binary) << setFlows(configText, flowList[k]);
+        remove(outputPath.c_str());
+        cout << "Flows=" << flowList[k] << " ..." << endl;
+
+        // 先启动接收端，输入重定向到 nul，使结束时的 pause 直接返回
+        FILE *receiver = _popen("receiver.exe < nul > nul", "r");
+        if (receiver == nullptr)
+        {
+            cerr << "can't start receiver.exe" << endl;
+            break;
+        }
+        this_thread::sleep_for(chrono::milliseconds(300));
+
+        // 运行发送端，从其输出中取出 Goodput 一行
+        FILE *sender = _popen("sender.exe < nul", "r");
+        if (sender == nullptr)
+        {
+            cerr << "can't start sender.exe" << endl;
+            _pclose(receiver);
+            break;
+        }
+        char line[1024];
+        while (fgets(line, sizeof(line), sender))
+        {
+            const char *p = strstr(line, "Goodput:");
+            if (p)
+                goodputs[k] = atof(p + 8);
+        }
+        _pclose(sender);
+        _pclose(receiver);
+
+        matches[k] = readFile(outputPath) == input;
+    }
+
+    // 恢复配置文件
+    ofstream("config.cfg", ios::binary) << configText;
+
+    cout << "\n  Flows   Goodput (KB/s)   Output\n";
+    for (size_t k = 0; k < flowList.size(); ++k)
+        cout << setw(7) << flowList[k] << setw(17) << fixed << setprecision(2) << goodputs[k]
+             << "   " << (matches[k] ? "match" : "MISMATCH") << "\n";
+
+    system("pause"); // 暂停，等待用户输入
+    return 0;
+}
@@ -9,9 +9,12 @@
 #include <fstream>
 #include <sstream>
 #include <cstdlib>
+#include <cctype>
 #include <winsock2.h> // Windows下网络编程核心头文件
 #include <ws2tcpip.h> // 包含 inet_pton, getaddrinfo 等函数
 #pragma comment(lib, "ws2_32.lib") // 链接 Winsock 库
+#include <bcrypt.h>                // Windows CNG 加密库，AES-GCM 在支持的 CPU 上使用 AES-NI 加速
+#pragma comment(lib, "bcrypt.lib") // 链接 CNG 库
 
 using namespace std;
 
@@ -33,6 +36,12 @@ map<string, string> loadConfig(const string& filename) {
     return config;
 }
 
+// 读取可选的整型配置项，缺省或为空时返回 defaultValue，旧的 config.cfg 不必补齐新增的配置项
+int configInt(map<string, string>& config, const string& key, int defaultValue) {
+    auto it = config.find(key);
+    return it == config.end() || it->second.empty() ? defaultValue : stoi(it->second);
+}
+
 // 实现 CRC-CCITT 校验算法，用于检测数据完整性
 uint16_t crc16(const char *data, size_t length)
 {
@@ -58,7 +67,7 @@ void printBufferHex(const char* data, size_t len) {
 
 
 // 定义 PDU（协议数据单元）结构体
-#pragma pack(1) // 结构体紧凑对齐
+#pragma pack(push, 1) // 结构体紧凑对齐
 struct PDU
 {
     int32_t totalPackets;  // 包总数
@@ -67,6 +76,9 @@ struct PDU
     char* data;        // 数据部分的内容
     uint16_t checksum; // CRC 校验
 
+    bool sealed = false;   // 是否为 AEAD 加密传输的 PDU
+    bool tagValid = false; // AEAD 认证标签是否校验通过
+
     void allocateData(int len) {
         length = len;
         data = new char[len];
@@ -85,8 +97,11 @@ struct PDU
         this->checksum = crc16(buffer.data(), buffer.size());
     }
 
-    // 检测校验码
+    // 检测校验码，AEAD 模式下以认证标签代替 CRC
     bool isValid() const {
+        if (sealed)
+            return tagValid;
+
         if(data == nullptr && checksum == 0)
             return true;
 
@@ -109,6 +124,8 @@ struct PDU
         seqNo = other.seqNo;
         length = other.length;
         checksum = other.checksum;
+        sealed = other.sealed;
+        tagValid = other.tagValid;
 
         if (length > 0 && other.data) {
             data = new char[length];
@@ -127,6 +144,8 @@ struct PDU
             seqNo = other.seqNo;
             length = other.length;
             checksum = other.checksum;
+            sealed = other.sealed;
+            tagValid = other.tagValid;
 
             if (length > 0 && other.data) {
                 data = new char[length];
@@ -138,12 +157,27 @@ struct PDU
         return *this;
     }
 
+    // 移动构造函数（转移数据所有权）
+    PDU(PDU&& other) noexcept {
+        totalPackets = other.totalPackets;
+        seqNo = other.seqNo;
+        length = other.length;
+        checksum = other.checksum;
+        sealed = other.sealed;
+        tagValid = other.tagValid;
+        data = other.data;
+
+        other.length = 0;
+        other.data = nullptr;
+    }
+
     // 构造和析构函数
     PDU() = default;
     ~PDU() {
         delete[] data;
     }
 };
+#pragma pack(pop) // 恢复默认对齐，后续结构体不受影响
 
 // 将 PDU 转换为连续内存块，计算长度并赋值给 outLen
 char* serializePDU(const PDU& pdu, int& outLen) {
@@ -203,6 +237,339 @@ PDU deserializePDU(const char* buffer, int bufferLen) {
     return pdu;
 }
 
+// 加密报文的类型，参与认证，一种报文不能被当作另一种接受（例如数据包被反射回发送方当作 ACK）
+enum AeadType : uint8_t {
+    AeadData = 'D',    // 数据包
+    AeadAck = 'A',     // ACK
+    AeadHello = 'H',   // 握手请求，数据部分为发送方的随机挑战值
+    AeadSession = 'S'  // 握手回复，数据部分为接收方生成的会话号
+};
+
+// AEAD 密钥（AES-256-GCM），由 config.cfg 中的预共享密钥 PSK（64 位十六进制）生成
+// 加密格式：头部(totalPackets, seqNo, length) | 密文 | nonce(12) | 认证标签(16)
+// 关联数据：头部 | 报文类型(1) | 子流编号(2) | 会话号(8)，后三项不上线路，由收发双方各自填入
+// 每条子流传输前先握手：发送方发出带随机挑战值的 HELLO，接收方回复本次运行随机生成的会话号，
+// 回复以挑战值作为关联数据中的会话号，发送方据此确认回复不是旧的重放。之后的数据包和 ACK 都以该会话号认证，
+// 其他子流的报文、之前传输的报文以及仍在重传的旧发送方的报文都无法通过认证
+// nonce = 本端随机前缀(8) | 发送计数(4)，每次发送（包括重传）都不同，同一密钥下不会重复
+struct AeadKey
+{
+    static const int NonceSize = 12;
+    static const int TagSize = 16;
+    static const int HeaderSize = sizeof(int32_t) + sizeof(uint32_t) + sizeof(uint16_t);
+    static const int AadSize = HeaderSize + 1 + sizeof(uint16_t) + 8;
+
+    BCRYPT_ALG_HANDLE alg = nullptr;
+    BCRYPT_KEY_HANDLE key = nullptr;
+    uint8_t salt[8] = {};      // nonce 随机前缀
+    uint32_t counter = 0;      // nonce 计数器
+    uint16_t flow = 0;       // 子流编号
+    uint8_t session[8] = {}; // 会话号，由接收方生成，握手后双方一致
+
+    // 解析十六进制 PSK 并创建密钥，失败返回 false
+    bool init(const string& pskHex, int flowIdx) {
+        flow = flowIdx;
+        if (pskHex.size() != 64)
+            return false;
+        for (char c : pskHex)
+            if (!isxdigit((unsigned char)c))
+                return false;
+
+        uint8_t keyBytes[32];
+        for (int i = 0; i < 32; ++i)
+            keyBytes[i] = (uint8_t)stoi(pskHex.substr(i * 2, 2), nullptr, 16);
+
+        if (!BCRYPT_SUCCESS(BCryptOpenAlgorithmProvider(&alg, BCRYPT_AES_ALGORITHM, nullptr, 0)))
+            return false;
+        if (!BCRYPT_SUCCESS(BCryptSetProperty(alg, BCRYPT_CHAINING_MODE, (PUCHAR)BCRYPT_CHAIN_MODE_GCM, sizeof(BCRYPT_CHAIN_MODE_GCM), 0)))
+            return false;
+        if (!BCRYPT_SUCCESS(BCryptGenerateSymmetricKey(alg, &key, nullptr, 0, keyBytes, sizeof(keyBytes), 0)))
+            return false;
+        return BCRYPT_SUCCESS(BCryptGenRandom(nullptr, salt, sizeof(salt), BCRYPT_USE_SYSTEM_PREFERRED_RNG));
+    }
+
+    // 接收方为本次传输随机生成会话号
+    bool newSession() {
+        return BCRYPT_SUCCESS(BCryptGenRandom(nullptr, session, sizeof(session), BCRYPT_USE_SYSTEM_PREFERRED_RNG));
+    }
+
+    // 生成下一个 nonce，计数器用尽时更换随机前缀
+    void nextNonce(uint8_t* nonce) {
+        if (++counter == 0)
+            BCryptGenRandom(nullptr, salt, sizeof(salt), BCRYPT_USE_SYSTEM_PREFERRED_RNG);
+        memcpy(nonce, salt, sizeof(salt));
+        memcpy(nonce + sizeof(salt), &counter, sizeof(counter));
+    }
+
+    // 拼接关联数据，sessionId 为本报文所属的会话号
+    void buildAad(uint8_t* aad, const char* header, AeadType type, const uint8_t* sessionId) const {
+        memcpy(aad, header, HeaderSize);
+        aad[HeaderSize] = type;
+        memcpy(aad + HeaderSize + 1, &flow, sizeof(flow));
+        memcpy(aad + HeaderSize + 1 + sizeof(flow), sessionId, sizeof(session));
+    }
+
+    AeadKey() = default;
+    AeadKey(const AeadKey&) = delete;
+    AeadKey& operator=(const AeadKey&) = delete;
+    ~AeadKey() {
+        if (key)
+            BCryptDestroyKey(key);
+        if (alg)
+            BCryptCloseAlgorithmProvider(alg, 0);
+    }
+};
+
+// 加密并序列化 PDU：先按明文格式写入头部和数据，再在缓冲区内原地加密数据部分
+// sessionId 为关联数据中的会话号；加密失败时缓冲区里仍是明文，释放后返回 nullptr，调用方应丢弃该包
+char* serializeSealedPDU(const PDU& pdu, AeadKey& aead, AeadType type, const uint8_t* sessionId, int& outLen) {
+    const int headerSize = AeadKey::HeaderSize;
+    outLen = headerSize + pdu.length + AeadKey::NonceSize + AeadKey::TagSize;
+    char* buffer = new char[outLen];
+
+    memcpy(buffer, &pdu.totalPackets, sizeof(int32_t));
+    memcpy(buffer + sizeof(int32_t), &pdu.seqNo, sizeof(uint32_t));
+    memcpy(buffer + sizeof(int32_t) + sizeof(uint32_t), &pdu.length, sizeof(uint16_t));
+    if (pdu.length > 0)
+        memcpy(buffer + headerSize, pdu.data, pdu.length);
+
+    PUCHAR payload = (PUCHAR)buffer + headerSize;
+    PUCHAR nonce = payload + pdu.length;
+    PUCHAR tag = nonce + AeadKey::NonceSize;
+    aead.nextNonce(nonce);
+
+    uint8_t aad[AeadKey::AadSize];
+    aead.buildAad(aad, buffer, type, sessionId);
+
+    BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO info;
+    BCRYPT_INIT_AUTH_MODE_INFO(info);
+    info.pbNonce = nonce;
+    info.cbNonce = AeadKey::NonceSize;
+    info.pbAuthData = aad;
+    info.cbAuthData = sizeof(aad);
+    info.pbTag = tag;
+    info.cbTag = AeadKey::TagSize;
+
+    ULONG written;
+    if (!BCRYPT_SUCCESS(BCryptEncrypt(aead.key, payload, pdu.length, &info, nullptr, 0, payload, pdu.length, &written, 0))) {
+        delete[] buffer;
+        return nullptr;
+    }
+
+    return buffer;
+}
+
+// 在接收缓冲区内原地解密并校验认证标签，还原出 PDU，校验结果记录在 tagValid 中
+// type 和 sessionId 为期望的报文类型和会话号，与发送时不一致则认证失败
+PDU deserializeSealedPDU(char* buffer, int bufferLen, AeadKey& aead, AeadType type, const uint8_t* sessionId) {
+    const int headerSize = AeadKey::HeaderSize;
+    PDU pdu;
+    pdu.totalPackets = 0; // 报文过短时直接返回，头部字段也要有确定的值
+    pdu.seqNo = 0;
+    pdu.data = nullptr;
+    pdu.length = 0;
+    pdu.checksum = 0;
+    pdu.sealed = true;
+    if (bufferLen < headerSize + AeadKey::NonceSize + AeadKey::TagSize)
+        return pdu;
+
+    uint16_t length;
+    memcpy(&pdu.totalPackets, buffer, sizeof(int32_t));
+    memcpy(&pdu.seqNo, buffer + sizeof(int32_t), sizeof(uint32_t));
+    memcpy(&length, buffer + sizeof(int32_t) + sizeof(uint32_t), sizeof(uint16_t));
+    if (bufferLen != headerSize + length + AeadKey::NonceSize + AeadKey::TagSize)
+        return pdu;
+
+    PUCHAR payload = (PUCHAR)buffer + headerSize;
+    PUCHAR nonce = payload + length;
+    uint8_t aad[AeadKey::AadSize];
+    aead.buildAad(aad, buffer, type, sessionId);
+
+    BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO info;
+    BCRYPT_INIT_AUTH_MODE_INFO(info);
+    info.pbNonce = nonce;
+    info.cbNonce = AeadKey::NonceSize;
+    info.pbAuthData = aad;
+    info.cbAuthData = sizeof(aad);
+    info.pbTag = nonce + AeadKey::NonceSize;
+    info.cbTag = AeadKey::TagSize;
+
+    ULONG written;
+    pdu.tagValid = BCRYPT_SUCCESS(BCryptDecrypt(aead.key, payload, length, &info, nullptr, 0, payload, length, &written, 0));
+    if (!pdu.tagValid)
+        return pdu;
+
+    pdu.length = length;
+    if (length > 0) {
+        pdu.data = new char[length];
+        memcpy(pdu.data, payload, length);
+    }
+    return pdu;
+}
+
+// 32 位序列号的循环比较（序列号算术），序号回绕到 0 之后仍能正确判断先后
+bool seqLess(uint32_t a, uint32_t b) {
+    return int32_t(a - b) < 0;
+}
+
+// 以 seqNo 取模为下标的定长环形表，用来保存窗口内每个序号的记录
+// 每个槽位同时记下所属序号，被其他序号占用的槽位视为空
+template <typename T>
+struct SeqRing
+{
+    vector<uint32_t> tags; // 槽位当前所属的序号
+    vector<char> used;     // 槽位是否已被占用
+    vector<T> values;      // 槽位中的记录
+    uint32_t mask;         // 容量取 2 的幂，下标为 seqNo & mask，序号回绕时不会错位
+
+    explicit SeqRing(int capacity) {
+        uint32_t size = 1;
+        while (size < uint32_t(capacity))
+            size <<= 1;
+        tags.assign(size, 0);
+        used.assign(size, 0);
+        values.assign(size, T());
+        mask = size - 1;
+    }
+
+    // 判断 seqNo 是否有记录
+    bool contains(uint32_t seqNo) const {
+        return used[seqNo & mask] && tags[seqNo & mask] == seqNo;
+    }
+
+    // 读取 seqNo 的记录，没有记录时返回默认值
+    T get(uint32_t seqNo) const {
+        return contains(seqNo) ? values[seqNo & mask] : T();
+    }
+
+    // 获取 seqNo 的记录用于修改，槽位被旧序号占用时先重置
+    T& operator[](uint32_t seqNo) {
+        uint32_t i = seqNo & mask;
+        if (!contains(seqNo)) {
+            tags[i] = seqNo;
+            used[i] = 1;
+            values[i] = T();
+        }
+        return values[i];
+    }
+
+    // 删除 seqNo 的记录
+    void erase(uint32_t seqNo) {
+        if (contains(seqNo))
+            used[seqNo & mask] = 0;
+    }
+};
+
+
+// 多条子流时为每条子流生成独立的日志路径，如 sender_log.txt -> sender_log_1.txt
+string flowLogPath(const string& path, int flowIdx, int flowCount) {
+    if (flowCount == 1)
+        return path;
+
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+    if (dot == string::npos || (slash != string::npos && dot < slash))
+        return path + "_" + to_string(flowIdx);
+    return path.substr(0, dot) + "_" + to_string(flowIdx) + path.substr(dot);
+}
+
+// 结构化事件追踪：文件头后紧跟定长二进制记录，分析工具可直接内存映射读取
+// 时间戳取 steady_clock 的纳秒计数，Windows 下基于 QPC，同一台机器上的收发两端可以对齐
+enum TraceType : uint8_t {
+    TraceSend,    // 发送方发出数据包，value 为模拟信道结果（TraceFate），code 为 NEW/TO/RT
+    TraceAck,     // 发送方收到有效 ACK，value 为更新后的累计确认序号
+    TraceTimeout, // 发送方超时，seqNo 为窗口起点，value 为超时前的 nextSeqNum
+    TraceSlide,   // 发送方窗口滑动，seqNo 为新的窗口起点，value 为原窗口起点
+    TraceRecv,    // 接收方收到有效数据包，value 为期望序号，code 为 OK/Buffered/NoErr
+    TraceCrcFail, // 接收方校验失败（CRC 或认证标签），value 为期望序号
+    TraceWrite    // 接收方写入文件，value 为写入字节数
+};
+
+enum TraceCode : uint8_t { CodeNew, CodeTO, CodeRT, CodeOK, CodeBuffered, CodeNoErr, CodeDataErr };
+
+enum TraceFate : uint8_t { FateSent, FateLost, FateCorrupted };
+
+const uint32_t TraceVersion = 1; // 追踪文件格式版本，记录格式变化时递增
+
+// 文件头和记录按 1 字节对齐写入磁盘，布局与编译器默认对齐无关
+#pragma pack(push, 1)
+struct TraceHeader {
+    char magic[4];       // 固定为 "GBNT"
+    uint32_t version;    // 格式版本
+    uint32_t recordSize; // 每条记录的字节数
+    uint32_t reserved;
+};
+
+struct TraceEvent {
+    int64_t timeNs; // 纳秒时间戳
+    uint32_t seqNo; // 相关序号
+    uint32_t value; // 随事件类型而定，见 TraceType
+    uint16_t flow;  // 子流编号
+    uint8_t type;   // TraceType
+    uint8_t code;   // TraceCode
+};
+#pragma pack(pop)
+
+static_assert(sizeof(TraceHeader) == 16, "TraceHeader must be 16 bytes");
+static_assert(sizeof(TraceEvent) == 20, "TraceEvent must be 20 bytes");
+
+// 追踪文件写入器，先写入内存缓冲，攒满、发生超时或距上次落盘超过 200ms 时批量落盘，
+// 卡住或被强行结束的运行也能留下可供分析的追踪；未打开时记录为空操作
+struct TraceWriter {
+    static const size_t BufferSize = 4096;            // 缓冲的记录条数上限
+    static const int64_t FlushIntervalNs = 200000000;    // 两次落盘的最长间隔
+
+    ofstream file;
+    uint16_t flow = 0;
+    vector<TraceEvent> buffer;
+    int64_t lastFlushNs = 0; // 上次落盘的时间
+
+    static int64_t nowNs() {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // 打开追踪文件并写入文件头，path 为空时不记录
+    bool open(const string& path, int flowIdx) {
+        flow = flowIdx;
+        if (path.empty())
+            return true;
+
+        file.open(path, ios::binary);
+        if (!file.is_open())
+            return false;
+
+        TraceHeader header = {{'G', 'B', 'N', 'T'}, TraceVersion, sizeof(TraceEvent), 0};
+        file.write((const char*)&header, sizeof(header));
+        file.flush();
+        lastFlushNs = nowNs();
+        buffer.reserve(BufferSize);
+        return true;
+    }
+
+    void record(TraceType type, uint32_t seqNo, uint32_t value, uint8_t code = 0) {
+        if (!file.is_open())
+            return;
+
+        int64_t now = nowNs();
+        buffer.push_back({now, seqNo, value, flow, type, code});
+        if (buffer.size() >= BufferSize || type == TraceTimeout || now - lastFlushNs >= FlushIntervalNs)
+            flush();
+    }
+
+    // 把缓冲的记录写入文件并交给操作系统，进程随后被结束也不会丢失
+    void flush() {
+        if (!buffer.empty())
+            file.write((const char*)buffer.data(), buffer.size() * sizeof(TraceEvent));
+        buffer.clear();
+        file.flush();
+        lastFlushNs = nowNs();
+    }
+
+    ~TraceWriter() {
+        if (file.is_open())
+            flush();
+    }
+};
 
 // 发送方日志函数
 void logSend(
@@ -229,7 +596,7 @@ void logRecv(
     int recvCount,          // 接收计数器
     uint32_t expectedSeqNo, // 期望的序列号
     uint32_t receivedSeqNo, // 实际接收的序列号
-    const string& status    // 接收状态（OK/DataErr/NoErr）
+    const string& status    // 接收状态（OK/DataErr/NoErr/Buffered）
 ) {
     // 获取当前时间
     auto now = chrono::system_clock::now();
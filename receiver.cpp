@@ -1,9 +1,12 @@
+#include <thread>
+#include <mutex>
 #include "proto.h"
 
 using namespace std;
 
 // 发送ACK的函数,组装ack，序列化并发送
-void sendACK(SOCKET sock, int ackSeqNo, sockaddr_in &senderAddr, int senderLen)
+// bitmap 非空时作为 SACK 位图放入数据部分，并计算校验和；aead 非空时加密发送
+void sendACK(SOCKET sock, uint32_t ackSeqNo, const vector<char> &bitmap, sockaddr_in &senderAddr, int senderLen, AeadKey *aead)
 {
     PDU ack;
     ack.totalPackets = 0; // ACK 不携带数据
@@ -12,12 +15,52 @@ void sendACK(SOCKET sock, int ackSeqNo, sockaddr_in &senderAddr, int senderLen)
     ack.data = nullptr;
     ack.checksum = 0;
 
+    if (!bitmap.empty())
+    {
+        ack.allocateData(bitmap.size());
+        memcpy(ack.data, bitmap.data(), bitmap.size());
+        ack.calculateChecksum();
+    }
+
     int outLen;
-    char *ackBuffer = serializePDU(ack, outLen);
+    char *ackBuffer = aead ? serializeSealedPDU(ack, *aead, AeadAck, aead->session, outLen) : serializePDU(ack, outLen);
+    if (ackBuffer == nullptr) // 加密失败，丢弃该 ACK
+        return;
     sendto(sock, ackBuffer, outLen, 0, (sockaddr *)&senderAddr, senderLen);
     delete[] ackBuffer;
 }
 
+// 回复 AEAD 握手：把本次传输的会话号发给发送方，关联数据中以 HELLO 携带的挑战值作为会话号
+void sendSession(SOCKET sock, AeadKey &aead, const char *challenge, sockaddr_in &senderAddr, int senderLen)
+{
+    PDU reply;
+    reply.totalPackets = 0;
+    reply.seqNo = 0;
+    reply.checksum = 0;
+    reply.data = nullptr;
+    reply.allocateData(sizeof(aead.session));
+    memcpy(reply.data, aead.session, sizeof(aead.session));
+
+    int outLen;
+    char *buffer = serializeSealedPDU(reply, aead, AeadSession, (const uint8_t *)challenge, outLen);
+    if (buffer == nullptr) // 加密失败，丢弃该回复，发送方会重发 HELLO
+        return;
+    sendto(sock, buffer, outLen, 0, (sockaddr *)&senderAddr, senderLen);
+    delete[] buffer;
+}
+
+// 根据已暂存的乱序包构造 SACK 位图，第 i 位表示序号 seq + i 的包已收到（第 0 位即当前等待帧，恒为 0）
+vector<char> buildSackBitmap(const SeqRing<vector<char>> &outOfOrder, uint32_t seq, int swSize)
+{
+    vector<char> bitmap((swSize + 7) / 8, 0);
+    for (int i = 1; i < swSize; ++i)
+    {
+        if (outOfOrder.contains(seq + i))
+            bitmap[i / 8] |= 1 << (i % 8);
+    }
+    return bitmap;
+}
+
 int main()
 {
     // 加载配置文件
@@ -29,13 +72,22 @@ int main()
     int swSize = stoi(config["SWSize"]);
     int initSeq = stoi(config["InitSeqNo"]);
     int timeout = stoi(config["Timeout"]);
-
+    bool sackEnable = configInt(config, "SACK", 0) != 0;
+    int flowCount = configInt(config, "Flows", 1); // 并行子流数，子流 i 使用端口 UDPPort + i
+    string psk = config["PSK"];                    // AEAD 预共享密钥，为空时明文传输
 
     string sendLogPath = config["SendLogPath"];
     string recvLogPath = config["RecvLogPath"];
     string inputPath = config["InputPath"];
     string outputPath = config["OutputPath"];
+    string recvTracePath = config["RecvTracePath"]; // 事件追踪文件路径，为空时不记录
 
+    // 子流数至少为 1
+    if (flowCount < 1)
+    {
+        cerr << "Invalid Flows, expected a positive integer.\n";
+        return 1;
+    }
 
     // 初始化Winsock环境
     WSADATA wsaData;
@@ -45,132 +97,248 @@ int main()
         return 1;
     }
 
-    // 创建一个UDP socket
-    SOCKET sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-    if (sock == INVALID_SOCKET)
-    {
-        std::cerr << "Socket creation failed.\n";
-        WSACleanup();
-        return 1;
-    }
-
-    // 设置本机地址结构
-    sockaddr_in localAddr = {};
-    localAddr.sin_family = AF_INET;         // 使用IPv4
-    localAddr.sin_port = htons(port);       // 设置接收端口
-    localAddr.sin_addr.s_addr = INADDR_ANY; // 设置本机IP地址
-
-    if (bind(sock, (sockaddr *)&localAddr, sizeof(localAddr)) == SOCKET_ERROR)
+    // 打开输出文件，各子流按全局偏移写入
+    ofstream outfile(outputPath, ios::binary);
+    if (!outfile.is_open())
     {
-        std::cerr << "Bind failed.\n";
-        closesocket(sock);
+        cerr << "can't open output file" << endl;
         WSACleanup();
         return 1;
     }
 
-    cout << "Initialize success, waiting for data...\n\n";
-
-    int seq = initSeq;        // 初始化待接收的序列号
-    int expectedPackets = -1; // 预期接收的包数
-
-    // 用于存储接收到的包（按序号）
-    map<int, vector<char>> receivedData;
-
-    // 记录每个包的重传次数，初始化为0
-    unordered_map<int, int> receiveCount;
+    mutex fileMutex;                        // 保护输出文件和控制台输出
+    vector<int> flowReceived(flowCount, 0); // 各子流已按序收到的包数
+    vector<int> flowExpected(flowCount, 0); // 各子流的包总数，收到首个包后才知道
+    vector<char> flowDone(flowCount, 0);    // 各子流是否已完整接收（各线程只写自己的元素）
 
-    // 打开日志文件
-    ofstream log(recvLogPath);
-    if (!log.is_open())
+    // 单条子流的接收过程，在独立线程中运行
+    auto receiveFlow = [&](int flowIdx)
     {
-        cerr << "can't open receiver_log" << endl;
-        return 1;
-    }
-
-    while (1)
-    {
-        char recvBuf[65536]; // 最大允许的数据缓冲区（64KB，可根据协议调小）
-        sockaddr_in senderAddr;
-        socklen_t senderLen = sizeof(senderAddr);
+        // 创建一个UDP socket
+        SOCKET sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (sock == INVALID_SOCKET)
+        {
+            lock_guard<mutex> lock(fileMutex);
+            std::cerr << "Socket creation failed.\n";
+            return;
+        }
 
-        // 接收数据（recvBuf 为原始字节流）
-        int ret = recvfrom(sock, recvBuf, sizeof(recvBuf), 0, (sockaddr *)&senderAddr, &senderLen);
+        // 设置本机地址结构
+        sockaddr_in localAddr = {};
+        localAddr.sin_family = AF_INET;             // 使用IPv4
+        localAddr.sin_port = htons(port + flowIdx); // 设置接收端口
+        localAddr.sin_addr.s_addr = INADDR_ANY;     // 设置本机IP地址
 
-        // 接收失败
-        if (ret == SOCKET_ERROR)
+        if (bind(sock, (sockaddr *)&localAddr, sizeof(localAddr)) == SOCKET_ERROR)
         {
-            cerr << "recvfrom failed.\n";
-            return 1;
+            lock_guard<mutex> lock(fileMutex);
+            std::cerr << "Bind failed.\n";
+            closesocket(sock);
+            return;
         }
 
-        // 将接受的数据反序列化为 PDU
-        PDU packet = deserializePDU(recvBuf, ret);
-        bool isValid = packet.isValid(); // 检查数据包的有效性
-
-        // 记录当前包的接收次数
-        if (receiveCount.count(packet.seqNo) == 0)
-            receiveCount[packet.seqNo] = 0;
+        // 创建 AEAD 密钥，各子流独立一份
+        AeadKey aead;
+        if (!psk.empty() && !(aead.init(psk, flowIdx) && aead.newSession()))
+        {
+            lock_guard<mutex> lock(fileMutex);
+            cerr << "Invalid PSK, expected 64 hex characters.\n";
+            closesocket(sock);
+            return;
+        }
+        AeadKey *aeadKey = psk.empty() ? nullptr : &aead;
 
-        int count = ++receiveCount[packet.seqNo];
-            
+        // 打开日志文件
+        ofstream log(flowLogPath(recvLogPath, flowIdx, flowCount));
+        if (!log.is_open())
+        {
+            lock_guard<mutex> lock(fileMutex);
+            cerr << "can't open receiver_log" << endl;
+            closesocket(sock);
+            return;
+        }
 
-        // 若接收帧正确，且就是当前的等待帧
-        if (isValid && packet.seqNo == seq)
+        // 打开事件追踪文件
+        TraceWriter trace;
+        if (!trace.open(recvTracePath.empty() ? "" : flowLogPath(recvTracePath, flowIdx, flowCount), flowIdx))
         {
-            // 第一个包到达时，记录总包数
-            if (seq == initSeq)
-                expectedPackets = packet.totalPackets;
+            lock_guard<mutex> lock(fileMutex);
+            cerr << "can't open receiver_trace" << endl;
+            closesocket(sock);
+            return;
+        }
 
-            printProgressBar(seq - initSeq + 1, expectedPackets);
-            logRecv(log, count, seq, packet.seqNo, "OK");
+        uint32_t seq = initSeq;   // 初始化待接收的序列号，用 seqLess 做循环比较
+        int expectedPackets = -1; // 预期接收的包数
 
-            // 更新下一个期望的序列号
-            ++seq;
+        // 开启 SACK 时暂存窗口内的乱序包，按序到达的数据直接写入输出文件
+        SeqRing<vector<char>> outOfOrder(swSize);
 
-            // 存储数据
-            receivedData[packet.seqNo - initSeq] = vector<char>(packet.data, packet.data + packet.length);
+        // 记录每个包的接收次数，发送方窗口最多落后一个窗口，故覆盖前后两个窗口
+        SeqRing<int> receiveCount(2 * swSize);
 
-            // 发送 ACK 确认包
-            sendACK(sock, packet.seqNo, senderAddr, senderLen);
+        // 未开启 SACK 时发送不带位图的普通 ACK
+        auto sackBitmap = [&]()
+        {
+            return sackEnable ? buildSackBitmap(outOfOrder, seq, swSize) : vector<char>();
+        };
 
-            // 若最后一个包确认收到，退出循环
-            if (expectedPackets > 0 && packet.seqNo == expectedPackets + initSeq - 1)
+        // 按全局偏移写入数据：子流内第 k 个包是文件中的第 k * flowCount + flowIdx 个包
+        auto writeData = [&](uint32_t seqNo, const char *data, int length)
+        {
+            long long index = (long long)(seqNo - initSeq) * flowCount + flowIdx;
+            {
+                lock_guard<mutex> lock(fileMutex);
+                outfile.seekp(index * dataSize);
+                outfile.write(data, length);
+            }
+            trace.record(TraceWrite, seqNo, length);
+        };
+
+        while (1)
+        {
+            char recvBuf[65536]; // 最大允许的数据缓冲区（64KB，可根据协议调小）
+            sockaddr_in senderAddr;
+            socklen_t senderLen = sizeof(senderAddr);
+
+            // 接收数据（recvBuf 为原始字节流）
+            int ret = recvfrom(sock, recvBuf, sizeof(recvBuf), 0, (sockaddr *)&senderAddr, &senderLen);
+
+            // 接收失败
+            if (ret == SOCKET_ERROR)
+            {
+                lock_guard<mutex> lock(fileMutex);
+                cerr << "recvfrom failed.\n";
                 break;
+            }
+
+            // 开启 AEAD 时，totalPackets 为 0 的报文是发送方的握手请求，回复本次传输的会话号
+            int32_t totalField = -1;
+            if (ret >= (int)sizeof(totalField))
+                memcpy(&totalField, recvBuf, sizeof(totalField));
+            if (aeadKey && totalField == 0)
+            {
+                const uint8_t noSession[8] = {};
+                PDU hello = deserializeSealedPDU(recvBuf, ret, *aeadKey, AeadHello, noSession);
+                if (hello.isValid() && hello.length == sizeof(aead.session))
+                    sendSession(sock, aead, hello.data, senderAddr, senderLen);
+                continue;
+            }
+
+            // 将接受的数据反序列化为 PDU，开启 AEAD 时在接收缓冲区内原地解密
+            PDU packet = aeadKey ? deserializeSealedPDU(recvBuf, ret, *aeadKey, AeadData, aead.session) : deserializePDU(recvBuf, ret);
+            bool isValid = packet.isValid(); // 检查数据包的有效性（CRC 或认证标签）
+
+            // 记录当前包的接收次数
+            int count = ++receiveCount[packet.seqNo];
+
+            // 若接收帧正确，且就是当前的等待帧
+            if (isValid && packet.seqNo == seq)
+            {
+                // 第一个包到达时，记录总包数
+                if (seq == uint32_t(initSeq))
+                    expectedPackets = packet.totalPackets;
+
+                logRecv(log, count, seq, packet.seqNo, "OK");
+                trace.record(TraceRecv, packet.seqNo, seq, CodeOK);
+
+                // 写入数据
+                writeData(seq, packet.data, packet.length);
+
+                // 更新下一个期望的序列号，并依次写入此前已暂存的乱序包
+                ++seq;
+                while (outOfOrder.contains(seq))
+                {
+                    writeData(seq, outOfOrder[seq].data(), outOfOrder[seq].size());
+                    outOfOrder.erase(seq);
+                    ++seq;
+                }
+
+                // 汇总各子流进度并打印进度条
+                {
+                    lock_guard<mutex> lock(fileMutex);
+                    flowReceived[flowIdx] = seq - initSeq;
+                    flowExpected[flowIdx] = expectedPackets;
+                    int received = 0, expected = 0;
+                    for (int i = 0; i < flowCount; ++i)
+                    {
+                        received += flowReceived[i];
+                        expected += flowExpected[i];
+                    }
+                    printProgressBar(received, expected);
+                }
+
+                // 发送 ACK 确认包
+                sendACK(sock, seq - 1, sackBitmap(), senderAddr, senderLen, aeadKey);
+
+                // 若最后一个包确认收到，退出循环
+                if (expectedPackets > 0 && seq == uint32_t(initSeq) + expectedPackets)
+                {
+                    flowDone[flowIdx] = 1;
+                    break;
+                }
+            }
+
+            // 接收包无效
+            else if (!isValid)
+            {
+                // cerr << "Invalid packet received, seqNo: " << packet.seqNo << endl;
+                logRecv(log, count, seq, packet.seqNo, "DataErr");
+                trace.record(TraceCrcFail, packet.seqNo, seq, CodeDataErr);
+
+                // 重新发送先前的 ACK 确认包
+                sendACK(sock, seq - 1, sackBitmap(), senderAddr, senderLen, aeadKey);
+            }
+
+            // 开启 SACK 时，暂存窗口内的乱序包，并在 ACK 中告知发送方
+            else if (sackEnable && seqLess(seq, packet.seqNo) && seqLess(packet.seqNo, seq + swSize))
+            {
+                logRecv(log, count, seq, packet.seqNo, "Buffered");
+                trace.record(TraceRecv, packet.seqNo, seq, CodeBuffered);
+
+                outOfOrder[packet.seqNo] = vector<char>(packet.data, packet.data + packet.length);
+
+                sendACK(sock, seq - 1, sackBitmap(), senderAddr, senderLen, aeadKey);
+            }
+
+            // 接收包有效但不是当前等待帧，丢弃收到的数据包
+            else
+            {
+                // cerr << "not the right packet, " << packet.seqNo << " != " << seq << endl;
+                logRecv(log, count, seq, packet.seqNo, "NoErr");
+                trace.record(TraceRecv, packet.seqNo, seq, CodeNoErr);
+
+                // 重新发送先前的 ACK 确认包
+                sendACK(sock, seq - 1, sackBitmap(), senderAddr, senderLen, aeadKey);
+            }
         }
 
-        // 接收包无效
-        else if (!isValid)
-        {
-            // cerr << "Invalid packet received, seqNo: " << packet.seqNo << endl;
-            logRecv(log, count, seq, packet.seqNo, "DataErr");
-
-            // 重新发送先前的 ACK 确认包
-            sendACK(sock, seq - 1, senderAddr, senderLen);
-        }
+        log.close();
+        closesocket(sock);
+    };
 
-        // 接收包有效但不是当前等待帧，丢弃收到的数据包
-        else
-        {
-            // cerr << "not the right packet, " << packet.seqNo << " != " << seq << endl;
-            logRecv(log, count, seq, packet.seqNo, "NoErr");
+    cout << "Initialize success, waiting for data...\n\n";
 
-            // 重新发送先前的 ACK 确认包
-            sendACK(sock, seq - 1, senderAddr, senderLen);
-        }
-    }
+    // 每条子流一个接收线程
+    vector<thread> threads;
+    for (int i = 0; i < flowCount; ++i)
+        threads.emplace_back(receiveFlow, i);
+    for (thread &t : threads)
+        t.join();
 
-    // 开始拼接文件
-    ofstream outfile(outputPath, ios::binary);
-    for (int i = 0; i < expectedPackets; ++i)
-    {
-        outfile.write(receivedData[i].data(), receivedData[i].size());
-    }
     outfile.close();
-    cout << "\n\nFile received and reconstructed successfully.\n";
 
-    closesocket(sock);
+    bool allDone = true;
+    for (int i = 0; i < flowCount; ++i)
+        allDone = allDone && flowDone[i];
+
+    if (allDone)
+        cout << "\n\nFile received and reconstructed successfully.\n";
+    else
+        cerr << "\n\nFile transfer incomplete.\n";
+
     WSACleanup();
     system("pause");
 
-    return 0;
-}
\ No newline at end of file
+    return allDone ? 0 : 1;
+}
@@ -0,0 +1,148 @@
+#include <deque>
+#include <algorithm>
+#include "proto.h"
+
+// 本地限速中继：模拟一条带宽受限、缓冲区很小的瓶颈链路，用于测试发送节拍（Pacing）的效果
+// 发送方 -> 127.0.0.1:listenPort+i -> 中继 -> 127.0.0.1:forwardPort+i -> 接收方，i 为子流编号
+// 数据方向经过一个 queue 个包的尾部丢弃队列，按 rate KB/s 出队；ACK 方向不限速
+// 用法：relay.exe listenPort forwardPort rate queue [flows]
+
+// 瓶颈队列中的一个数据报
+struct QueuedPacket
+{
+    int flow;          // 所属子流
+    vector<char> data; // 报文内容
+};
+
+int main(int argc, char *argv[])
+{
+    if (argc < 5)
+    {
+        cerr << "Usage: relay.exe listenPort forwardPort rate(KB/s) queue(packets) [flows]\n";
+        return 1;
+    }
+    int listenPort = atoi(argv[1]);
+    int forwardPort = atoi(argv[2]);
+    double rate = atof(argv[3]) * 1024; // 出队速率（字节/秒）
+    size_t queueSize = atoi(argv[4]);
+    int flowCount = argc > 5 ? atoi(argv[5]) : 1;
+    if (rate <= 0 || queueSize < 1 || flowCount < 1)
+    {
+        cerr << "Invalid arguments, expected positive rate, queue and flows.\n";
+        return 1;
+    }
+
+    // 初始化Winsock环境
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+    {
+        cerr << "WSAStartup failed.\n";
+        return 1;
+    }
+
+    // 每条子流两个socket：front 绑定 listenPort+i 面向发送方，back 面向接收方
+    vector<SOCKET> front(flowCount), back(flowCount);
+    vector<sockaddr_in> senderAddr(flowCount), receiverAddr(flowCount);
+    vector<bool> senderKnown(flowCount, false);
+    for (int i = 0; i < flowCount; ++i)
+    {
+        front[i] = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        back[i] = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (front[i] == INVALID_SOCKET || back[i] == INVALID_SOCKET)
+        {
+            cerr << "Socket creation failed.\n";
+            WSACleanup();
+            return 1;
+        }
+
+        sockaddr_in listenAddr = {};
+        listenAddr.sin_family = AF_INET;
+        listenAddr.sin_port = htons(listenPort + i);
+        listenAddr.sin_addr.s_addr = inet_addr("127.0.0.1");
+        if (bind(front[i], (sockaddr *)&listenAddr, sizeof(listenAddr)) == SOCKET_ERROR)
+        {
+            cerr << "Bind failed on port " << listenPort + i << ".\n";
+            WSACleanup();
+            return 1;
+        }
+
+        receiverAddr[i] = {};
+        receiverAddr[i].sin_family = AF_INET;
+        receiverAddr[i].sin_port = htons(forwardPort + i);
+        receiverAddr[i].sin_addr.s_addr = inet_addr("127.0.0.1");
+
+        // 设置socket为非阻塞的
+        u_long mode = 1;
+        ioctlsocket(front[i], FIONBIO, &mode);
+        ioctlsocket(back[i], FIONBIO, &mode);
+    }
+
+    cout << "Relay 127.0.0.1:" << listenPort << " -> 127.0.0.1:" << forwardPort << ", flows: " << flowCount
+         << ", rate: " << argv[3] << " KB/s, queue: " << queueSize << " packets\n";
+
+    deque<QueuedPacket> queue;                       // 瓶颈队列
+    auto nextSendTime = chrono::steady_clock::now(); // 队首报文最早的出队时刻
+    auto lastReport = chrono::steady_clock::now();
+    long long inCount = 0, dropCount = 0, outBytes = 0; // 入队尝试数、丢弃数、出队字节数
+    char recvBuf[65536];
+
+    while (true)
+    {
+        for (int i = 0; i < flowCount; ++i)
+        {
+            // 发送方 -> 接收方：进入瓶颈队列，队列满时尾部丢弃
+            sockaddr_in fromAddr = {};
+            socklen_t fromLen = sizeof(fromAddr);
+            int ret;
+            while ((ret = recvfrom(front[i], recvBuf, sizeof(recvBuf), 0, (sockaddr *)&fromAddr, &fromLen)) > 0)
+            {
+                senderAddr[i] = fromAddr;
+                senderKnown[i] = true;
+                inCount++;
+                if (queue.size() < queueSize)
+                    queue.push_back({i, vector<char>(recvBuf, recvBuf + ret)});
+                else
+                    dropCount++;
+                fromLen = sizeof(fromAddr);
+            }
+
+            // 接收方 -> 发送方：ACK 直接转发
+            while ((ret = recvfrom(back[i], recvBuf, sizeof(recvBuf), 0, nullptr, nullptr)) > 0)
+                if (senderKnown[i])
+                    sendto(front[i], recvBuf, ret, 0, (sockaddr *)&senderAddr[i], sizeof(senderAddr[i]));
+        }
+
+        // 按链路速率出队，出队时刻累加报文的传输时间
+        auto now = chrono::steady_clock::now();
+        if (!queue.empty() && now >= nextSendTime)
+        {
+            QueuedPacket &packet = queue.front();
+            sendto(back[packet.flow], packet.data.data(), (int)packet.data.size(), 0, (sockaddr *)&receiverAddr[packet.flow], sizeof(receiverAddr[packet.flow]));
+            outBytes += packet.data.size();
+            nextSendTime = max(nextSendTime, now) + chrono::nanoseconds((long long)(packet.data.size() * 1e9 / rate));
+            queue.pop_front();
+        }
+
+        // 每秒打印一次统计
+        if (now - lastReport >= chrono::seconds(1))
+        {
+            cout << "\rin: " << inCount << ", dropped: " << dropCount << " (" << fixed << setprecision(2)
+                 << (inCount ? 100.0 * dropCount / inCount : 0.0) << "%), forwarded: " << outBytes / 1024 << " KB   " << flush;
+            lastReport = now;
+        }
+
+        // 队列为空时阻塞等待新报文；队列非空时忙等，Windows 下定时器精度不足以按包间隔出队
+        if (queue.empty())
+        {
+            fd_set readSet;
+            FD_ZERO(&readSet);
+            for (int i = 0; i < flowCount; ++i)
+            {
+                FD_SET(front[i], &readSet);
+                FD_SET(back[i], &readSet);
+            }
+            timeval wait = {0, 100000};
+            select(0, &readSet, nullptr, nullptr, &wait);
+        }
+    }
+}
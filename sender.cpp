@@ -1,6 +1,9 @@
 #include <thread>
+#include <mutex>
 #include <random>
 #include <cmath>
+#include <deque>
+#include <functional>
 #include "proto.h"
 
 // 发送PDU函数，能随机模拟丢包或注入错误
@@ -9,48 +12,141 @@ void sendWithError(
     int &sendCount,                                  // 重传计数器
     const string &status,                            // 发送状态
     int lostRate, int errorRate,                     // 丢包率和错误率
-    int ackedNo,                                     // 已接收的ACK序列号
-    ofstream &log                                    // 日志文件
+    uint32_t ackedNo,                                // 已接收的ACK序列号
+    ofstream &log,                                   // 日志文件
+    TraceWriter &trace,                              // 事件追踪
+    AeadKey *aead                                    // AEAD 密钥，为空时明文发送
 )
 {
-    // 随机数生成器
-    static random_device rd;
-    static mt19937 gen(rd());
-    static uniform_int_distribution<> dist(0, 99);
+    // 随机数生成器，各发送线程独立一份
+    thread_local random_device rd;
+    thread_local mt19937 gen(rd());
+    thread_local uniform_int_distribution<> dist(0, 99);
 
     // 生成一个 0-99 的随机值来模拟丢包或注入错误的情况
     int randVal = dist(gen);
 
-    // 序列化 PDU
+    // 序列化 PDU，开启 AEAD 时在序列化缓冲区内原地加密
     int packetLen;
-    char *serialized = serializePDU(pdu, packetLen);
+    char *serialized = aead ? serializeSealedPDU(pdu, *aead, AeadData, aead->session, packetLen) : serializePDU(pdu, packetLen);
+
+    // 追踪记录的发送状态码
+    uint8_t code = status == "NEW" ? CodeNew : (status == "TO " ? CodeTO : CodeRT);
+
+    // 加密失败，不能把明文发出去，按丢包处理，等待超时重传
+    if (serialized == nullptr)
+    {
+        logSend(log, sendCount, pdu.seqNo, status, ackedNo);
+        trace.record(TraceSend, pdu.seqNo, FateLost, code);
+        return;
+    }
 
     // 根据随机值判断是否丢包、注入错误或正常发送
     if (randVal < lostRate)
     {
         // 丢弃，不发送，仅写入发送日志
         logSend(log, sendCount, pdu.seqNo, status, ackedNo);
+        trace.record(TraceSend, pdu.seqNo, FateLost, code);
     }
     else if (randVal < lostRate + errorRate)
     {
-        // 注入错误，不重新计算 checksum，故意让校验失败
+        // 注入错误，不重新计算 checksum（或认证标签），故意让校验失败
         serialized[sizeof(int) + sizeof(uint32_t) + sizeof(uint16_t)] ^= 0xFF; // 反转数据部分第一个字节
         sendto(sock, serialized, packetLen, 0, (sockaddr *)&destAddr, sizeof(destAddr));
         logSend(log, sendCount, pdu.seqNo, status, ackedNo);
+        trace.record(TraceSend, pdu.seqNo, FateCorrupted, code);
     }
     else
     {
         // 正常发送
         sendto(sock, serialized, packetLen, 0, (sockaddr *)&destAddr, sizeof(destAddr));
         logSend(log, sendCount, pdu.seqNo, status, ackedNo);
+        trace.record(TraceSend, pdu.seqNo, FateSent, code);
     }
 
     // 释放序列化后的内存
     delete[] serialized;
 }
 
-// 读取文件并切分为多个 PDU
-vector<PDU> splitFileToPackets(const string &filename, int dataSize, int initSeq, int &totalPackets)
+// AEAD 握手：发送带随机挑战值的 HELLO，等待接收方回复会话号，每个超时周期重发一次
+// 回复以挑战值作为关联数据中的会话号，旧的回复重放过来无法通过认证；成功后会话号存入 aead.session
+void handshake(SOCKET sock, const sockaddr_in &destAddr, AeadKey &aead, int timeout)
+{
+    uint8_t challenge[8];
+    BCryptGenRandom(nullptr, challenge, sizeof(challenge), BCRYPT_USE_SYSTEM_PREFERRED_RNG);
+
+    PDU hello;
+    hello.totalPackets = 0; // 数据包的 totalPackets 至少为 1，接收方据此识别握手请求
+    hello.seqNo = 0;
+    hello.checksum = 0;
+    hello.data = nullptr;
+    hello.allocateData(sizeof(challenge));
+    memcpy(hello.data, challenge, sizeof(challenge));
+
+    const uint8_t noSession[8] = {}; // 握手请求还没有会话号
+    char recvBuf[65536];
+
+    while (true)
+    {
+        int len;
+        char *buffer = serializeSealedPDU(hello, aead, AeadHello, noSession, len);
+        if (buffer != nullptr)
+        {
+            sendto(sock, buffer, len, 0, (sockaddr *)&destAddr, sizeof(destAddr));
+            delete[] buffer;
+        }
+
+        auto startTime = chrono::steady_clock::now();
+        while (chrono::steady_clock::now() - startTime < chrono::milliseconds(timeout))
+        {
+            sockaddr_in fromAddr = {};
+            socklen_t fromLen = sizeof(fromAddr);
+            int ret = recvfrom(sock, recvBuf, sizeof(recvBuf), 0, (sockaddr *)&fromAddr, &fromLen);
+            if (ret <= 0 || fromAddr.sin_addr.s_addr != destAddr.sin_addr.s_addr || fromAddr.sin_port != destAddr.sin_port)
+                continue;
+
+            PDU reply = deserializeSealedPDU(recvBuf, ret, aead, AeadSession, challenge);
+            if (reply.isValid() && reply.length == sizeof(aead.session))
+            {
+                memcpy(aead.session, reply.data, sizeof(aead.session));
+                return;
+            }
+        }
+    }
+}
+
+// 发送节拍器：按目标速率在相邻两次发送之间插入间隔，把窗口内的突发发送摊开
+struct Pacer
+{
+    chrono::steady_clock::time_point nextSendTime = chrono::steady_clock::now(); // 下一个包允许发送的时刻
+    chrono::nanoseconds interval{0};                                            // 相邻两次发送的间隔，0 表示不限速
+
+    // 按 rate（字节/秒）设置发送间隔
+    void setRate(double bytesPerSec, int packetLen)
+    {
+        interval = chrono::nanoseconds(static_cast<long long>(packetLen * 1e9 / bytesPerSec));
+    }
+
+    // 阻塞到允许发送下一个包为止，自旋期间反复调用 idle
+    void wait(const function<void()> &idle)
+    {
+        // Windows 下 sleep 的精度约为 15.6ms，只有剩余时间足够长才让出 CPU，其余时间自旋等待
+        auto remaining = nextSendTime - chrono::steady_clock::now();
+        if (remaining > chrono::milliseconds(20))
+            this_thread::sleep_for(remaining - chrono::milliseconds(16));
+        while (chrono::steady_clock::now() < nextSendTime)
+        {
+            idle();
+            this_thread::yield();
+        }
+
+        // 空闲期间不累积发送额度，避免空闲后再次突发
+        nextSendTime = max(nextSendTime, chrono::steady_clock::now()) + interval;
+    }
+};
+
+// 读取文件并切分为多个 PDU，checksum 为 false 时（开启 AEAD）不计算 CRC
+vector<PDU> splitFileToPackets(const string &filename, int dataSize, int initSeq, int &totalPackets, bool checksum)
 {
     cout << "split file" << endl;
     ifstream file(filename, ios::binary | ios::ate);
@@ -67,22 +163,23 @@ vector<PDU> splitFileToPackets(const string &filename, int dataSize, int initSeq
     vector<PDU> packets;
     packets.reserve(totalPackets);
 
-    for (int i = initSeq; i < totalPackets + initSeq; ++i)
+    for (int index = 0; index < totalPackets; ++index) // 相对索引（0开始）
     {
-        int index = i - initSeq; // 相对索引（0开始）
-
         // 每个包的大小, 考虑最后一个包需要额外切分
         int thisSize = (index < totalPackets - 1)
                            ? dataSize
                            : static_cast<int>(fileSize - (totalPackets - 1) * dataSize);
 
         PDU pdu;
-        pdu.totalPackets = totalPackets; // 设置总包数
-        pdu.seqNo = i;
+        pdu.totalPackets = totalPackets;       // 设置总包数
+        pdu.seqNo = uint32_t(initSeq) + index; // 先转为无符号再相加，序号回绕时不会发生有符号溢出
         pdu.length = thisSize;
-        pdu.allocateData(thisSize);    // 分配数据空间
-        file.read(pdu.data, thisSize); // 读取对应内容
-        pdu.calculateChecksum();       // 计算校验和
+        pdu.allocateData(thisSize);            // 分配数据空间
+        file.read(pdu.data, thisSize);         // 读取对应内容
+        if (checksum)
+            pdu.calculateChecksum();           // 计算校验和
+        else
+            pdu.checksum = 0;
 
         packets.push_back(pdu);
     }
@@ -91,6 +188,54 @@ vector<PDU> splitFileToPackets(const string &filename, int dataSize, int initSeq
     return packets;
 }
 
+// 把切分好的数据包按轮转方式分给各子流：文件中的第 g 个包分给子流 g % flowCount，
+// 在子流内的序号为 initSeq + g / flowCount。分不到数据的子流补一个空包，保证每条子流都能正常结束
+// 开启 AEAD 时以认证标签代替 CRC，checksum 为 false，不再重新计算校验和
+vector<vector<PDU>> stripePackets(vector<PDU> &packets, int flowCount, int initSeq, bool checksum)
+{
+    vector<vector<PDU>> flows(flowCount);
+    if (flowCount == 1)
+    {
+        flows[0] = move(packets);
+        return flows;
+    }
+
+    for (size_t g = 0; g < packets.size(); ++g)
+        flows[g % flowCount].push_back(move(packets[g]));
+    packets.clear();
+
+    for (vector<PDU> &flow : flows)
+    {
+        if (flow.empty())
+        {
+            PDU pdu;
+            pdu.allocateData(0);
+            pdu.checksum = 0;
+            flow.push_back(move(pdu));
+        }
+
+        // 重新编号并计算校验和
+        for (size_t k = 0; k < flow.size(); ++k)
+        {
+            flow[k].totalPackets = flow.size();
+            flow[k].seqNo = uint32_t(initSeq) + k;
+            if (checksum)
+                flow[k].calculateChecksum();
+        }
+    }
+    return flows;
+}
+
+// 单条子流的发送统计
+struct FlowStats
+{
+    int TOCount = 0;        // 超时重发次数
+    int RTCount = 0;        // 丢包/错包重传次数
+    int totalSendCount = 0; // 总发送次数
+    int SACKSkipCount = 0;  // 因 SACK 跳过的重传次数
+    bool done = false;      // 是否全部确认
+};
+
 int main()
 {
     // 加载配置文件
@@ -102,11 +247,23 @@ int main()
     int swSize = stoi(config["SWSize"]);
     int initSeq = stoi(config["InitSeqNo"]);
     int timeout = stoi(config["Timeout"]);
+    bool pacingEnable = configInt(config, "Pacing", 0) != 0;
+    int pacingRate = configInt(config, "PacingRate", 0); // 限速（KB/s），为 0 时按 窗口大小/SRTT 自适应
+    int flowCount = configInt(config, "Flows", 1);       // 并行子流数，子流 i 使用端口 UDPPort + i
+    string psk = config["PSK"];                          // AEAD 预共享密钥，为空时明文传输
 
     string sendLogPath = config["SendLogPath"];
     string recvLogPath = config["RecvLogPath"];
     string inputPath = config["InputPath"];
     string outputPath = config["OutputPath"];
+    string sendTracePath = config["SendTracePath"]; // 事件追踪文件路径，为空时不记录
+
+    // 子流数至少为 1
+    if (flowCount < 1)
+    {
+        cerr << "Invalid Flows, expected a positive integer.\n";
+        return 1;
+    }
 
     // 初始化Winsock环境
     WSADATA wsaData;
@@ -116,158 +273,319 @@ int main()
         return 1;
     }
 
-    // 创建一个UDP socket
-    SOCKET sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-    if (sock == INVALID_SOCKET)
-    {
-        std::cerr << "Socket creation failed.\n";
-        WSACleanup(); // 清理Winsock环境
-        return 1;
-    }
+    // 参数设置
+    int totalPackets = 0;                                                                              // 总包数
+    vector<PDU> packets = splitFileToPackets(inputPath, dataSize, initSeq, totalPackets, psk.empty()); // 从文件中切分数据包
 
-    // 设置socket为非阻塞的
-    u_long mode = 1;
-    ioctlsocket(sock, FIONBIO, &mode);
+    double fileBytes = 0; // 文件字节数，用于计算有效吞吐量
+    for (const PDU &pdu : packets)
+        fileBytes += pdu.length;
 
-    // 设置目标地址结构
-    sockaddr_in destAddr = {};
-    destAddr.sin_family = AF_INET;                     // 使用IPv4
-    destAddr.sin_port = htons(port);                   // 设置目标端口
-    destAddr.sin_addr.s_addr = inet_addr("127.0.0.1"); // 设置目标IP地址，这里使用本机地址进行测试
+    vector<vector<PDU>> flowPackets = stripePackets(packets, flowCount, initSeq, psk.empty()); // 分给各子流的数据包
 
-    socklen_t receiverLen = sizeof(destAddr); // 设置接收地址长度
+    mutex consoleMutex;                  // 保护控制台输出
+    vector<int> flowAcked(flowCount, 0); // 各子流已确认的包数
+    vector<FlowStats> stats(flowCount);  // 各子流的发送统计
 
-    // 打开日志文件
-    ofstream log(sendLogPath);
-    if (!log.is_open())
+    // 单条子流的 GBN 发送过程，在独立线程中运行
+    auto sendFlow = [&](int flowIdx)
     {
-        cerr << "can't open sender_log" << endl;
-        return 1;
-    }
+        vector<PDU> &packets = flowPackets[flowIdx]; // 本子流的数据包
+        int flowTotal = packets.size();              // 本子流的包数
+        FlowStats &stat = stats[flowIdx];
 
-    // 参数设置
-    int totalPackets = 0;                                                                 // 总包数
-    vector<PDU> packets = splitFileToPackets(inputPath, dataSize, initSeq, totalPackets); // 从文件中切分数据包
+        // 创建一个UDP socket
+        SOCKET sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (sock == INVALID_SOCKET)
+        {
+            lock_guard<mutex> lock(consoleMutex);
+            std::cerr << "Socket creation failed.\n";
+            return;
+        }
 
-    int seq = initSeq;        // 当前窗口左侧序号
-    int nextSeqNum = initSeq; // 下一个要发送的包序列号
+        // 设置socket为非阻塞的
+        u_long mode = 1;
+        ioctlsocket(sock, FIONBIO, &mode);
 
-    unordered_map<int, int> retransmitCount; // 记录每个包的重传次数，初始化为0
-    for (int i = 0; i < totalPackets; ++i)
-    {
-        retransmitCount[initSeq + i] = 0;
-    }
+        // 设置目标地址结构
+        sockaddr_in destAddr = {};
+        destAddr.sin_family = AF_INET;                     // 使用IPv4
+        destAddr.sin_port = htons(port + flowIdx);         // 设置目标端口
+        destAddr.sin_addr.s_addr = inet_addr("127.0.0.1"); // 设置目标IP地址，这里使用本机地址进行测试
 
-    cout << "totalPackets: " << totalPackets << endl;
-    cout << "Initialize success, preparing to send...\n\n";
-    printProgressBar(0, totalPackets);                           // 打印初始进度条
-    auto senderStartTime = chrono::high_resolution_clock::now(); // 记录发送开始时间
-    int TOCount = 0;                                             // 记录超时重发次数
-    int RTCount = 0;                                             // 记录丢包/错包重传次数
-    int totalSendCount = 0;                                      // 记录总发送次数
+        // ACK 的来源地址单独接收，不能覆盖 destAddr，只接受来自接收方的报文
+        sockaddr_in fromAddr = {};
+        socklen_t fromLen = sizeof(fromAddr);
 
-    // ACK接收缓冲区
-    char recvBuf[65536];      // 最大允许的数据缓冲区（64KB，可根据协议调小）
-    int ackReceived = -1;     // 已收到的最远ACK序列号
-    bool timeoutFlag = false; // 超时标志
+        // 创建 AEAD 密钥，各子流独立一份
+        AeadKey aead;
+        if (!psk.empty() && !aead.init(psk, flowIdx))
+        {
+            lock_guard<mutex> lock(consoleMutex);
+            cerr << "Invalid PSK, expected 64 hex characters.\n";
+            closesocket(sock);
+            return;
+        }
+        AeadKey *aeadKey = psk.empty() ? nullptr : &aead;
 
-    // 发送窗口内的数据包
-    while (seq < totalPackets + initSeq)
-    {
-        // 当下一个要发送的包还在窗口内时发送数据包
-        while (nextSeqNum < seq + swSize && nextSeqNum < totalPackets + initSeq)
+        // 打开日志文件
+        ofstream log(flowLogPath(sendLogPath, flowIdx, flowCount));
+        if (!log.is_open())
         {
-            // 从切分好的列表中获取当前要发送的包
-            PDU &pdu = packets[nextSeqNum - initSeq];
+            lock_guard<mutex> lock(consoleMutex);
+            cerr << "can't open sender_log" << endl;
+            closesocket(sock);
+            return;
+        }
 
-            // 查map获取当前包的重传次数
-            int sendCount = retransmitCount[nextSeqNum];
-            retransmitCount[nextSeqNum] = ++sendCount; // 更新重传次数
+        // 打开事件追踪文件
+        TraceWriter trace;
+        if (!trace.open(sendTracePath.empty() ? "" : flowLogPath(sendTracePath, flowIdx, flowCount), flowIdx))
+        {
+            lock_guard<mutex> lock(consoleMutex);
+            cerr << "can't open sender_trace" << endl;
+            closesocket(sock);
+            return;
+        }
 
-            // 定义当前包的发送状态：初次发送/超时/重传
-            string status = sendCount == 1 ? "NEW" : (timeoutFlag ? "TO " : "RT ");
+        // 开启 AEAD 时先握手，取得接收方生成的会话号
+        if (aeadKey)
+            handshake(sock, destAddr, aead, timeout);
+
+        // 序号均为 32 位无符号数，用 seqLess 做循环比较，允许序号回绕
+        uint32_t seq = initSeq;                          // 当前窗口左侧序号
+        uint32_t nextSeqNum = initSeq;                   // 下一个要发送的包序列号
+        uint32_t endSeq = uint32_t(initSeq) + flowTotal; // 最后一个包之后的序号，先转为无符号再相加，避免有符号溢出
+
+        // 只有窗口内的序号需要记录，用窗口大小的环形表代替按包数增长的表
+        SeqRing<int> retransmitCount(swSize);                     // 记录每个包的重传次数，初始为0
+        SeqRing<char> sacked(swSize);                             // 记录接收方通过 SACK 位图告知已暂存的包
+        SeqRing<chrono::steady_clock::time_point> sendTime(swSize); // 记录每个包最近一次的发送时刻，用于估计 RTT
+        double srtt = 0;                                            // 平滑 RTT（秒），0 表示尚无样本
+
+        // 初始化发送节拍器，限速由各子流平分
+        // 自适应模式在取得 RTT 样本前假设 RTT 等于超时时间，第一个窗口也按节拍发出
+        Pacer pacer;
+        if (pacingEnable && pacingRate > 0)
+            pacer.setRate(pacingRate * 1024.0 / flowCount, dataSize);
+        else if (pacingEnable)
+            pacer.setRate(swSize * dataSize / (timeout / 1000.0), dataSize);
+
+        // ACK接收缓冲区
+        char recvBuf[65536];      // 最大允许的数据缓冲区（64KB，可根据协议调小）
+        uint32_t ackReceived = uint32_t(initSeq) - 1; // 已收到的最远ACK序列号
+        bool timeoutFlag = false; // 超时标志
+
+        // 已到达但尚未处理的 ACK 及其到达时刻。按节拍发送的等待期间也收取 ACK，
+        // RTT 按到达时刻计算，不会把发送阶段里 ACK 在套接字中等待的时间算进去
+        deque<pair<chrono::steady_clock::time_point, vector<char>>> arrivedAcks;
+        auto pollAcks = [&]()
+        {
+            int ret;
+            while ((ret = recvfrom(sock, recvBuf, sizeof(recvBuf), 0, (sockaddr *)&fromAddr, &fromLen)) > 0)
+            {
+                // 丢弃不是来自接收方的报文
+                if (fromAddr.sin_addr.s_addr != destAddr.sin_addr.s_addr || fromAddr.sin_port != destAddr.sin_port)
+                    continue;
+                arrivedAcks.emplace_back(chrono::steady_clock::now(), vector<char>(recvBuf, recvBuf + ret));
+            }
+        };
 
-            // 重传计数
-            if (status == "TO ")
-                TOCount++;
-            else if (status == "RT ")
-                RTCount++;
+        // 发送窗口内的数据包
+        while (seqLess(seq, endSeq))
+        {
+            // 当下一个要发送的包还在窗口内时发送数据包
+            while (seqLess(nextSeqNum, seq + swSize) && seqLess(nextSeqNum, endSeq))
+            {
+                // 接收方已暂存该包，重传时跳过，累计确认语义不变
+                if (sacked.get(nextSeqNum))
+                {
+                    stat.SACKSkipCount++;
+                    nextSeqNum++;
+                    continue;
+                }
 
-            // 有出错概率地发送数据包
-            sendWithError(sock, destAddr, pdu, sendCount, status, lostRate, errorRate, ackReceived, log);
+                // 从切分好的列表中获取当前要发送的包
+                PDU &pdu = packets[nextSeqNum - initSeq];
 
-            totalSendCount++;    // 统计总发送次数
-            nextSeqNum++;        // 更新下一个序列号
-            timeoutFlag = false; // 重置timeout标志
-        }
+                // 查环形表获取并更新当前包的重传次数
+                int sendCount = ++retransmitCount[nextSeqNum];
 
-        // 将窗口内数据包全部发送完毕，开始等待ACK
-        bool ackFlag = false;                                  // 当前超时期内是否收到ACK的标志
-        auto startTime = chrono::high_resolution_clock::now(); // 记录开始等待时间
+                // 定义当前包的发送状态：初次发送/超时/重传
+                string status = sendCount == 1 ? "NEW" : (timeoutFlag ? "TO " : "RT ");
 
-        // 等待ACK确认
-        while (!ackFlag)
-        {
-            // 检查超时
-            auto currentTime = chrono::high_resolution_clock::now();
-            auto elapsed = chrono::duration_cast<std::chrono::milliseconds>(currentTime - startTime);
+                // 重传计数
+                if (status == "TO ")
+                    stat.TOCount++;
+                else if (status == "RT ")
+                    stat.RTCount++;
 
-            // 超时处理：更新窗口位置，并发送窗口内所有未确认包
-            if (elapsed.count() >= timeout)
-            {
-                timeoutFlag = true;                  // 设置超时标志
-                seq = max(ackReceived + 1, initSeq); // 更新窗口起始位置
-                nextSeqNum = seq;                    // 重置下一个要发送的包序列号
-                break;
+                // 按节拍发送，避免整窗突发挤爆缓冲区
+                if (pacingEnable)
+                    pacer.wait(pollAcks);
+                sendTime[nextSeqNum] = chrono::steady_clock::now();
+
+                // 有出错概率地发送数据包
+                sendWithError(sock, destAddr, pdu, sendCount, status, lostRate, errorRate, ackReceived, log, trace, aeadKey);
+
+                stat.totalSendCount++; // 统计总发送次数
+                nextSeqNum++;          // 更新下一个序列号
+                timeoutFlag = false;   // 重置timeout标志
             }
 
-            // 未超时，正常接收 ACK
-            int ret = recvfrom(sock, recvBuf, sizeof(recvBuf), 0, (sockaddr *)&destAddr, &receiverLen);
-            if (ret > 0)
+            // 将窗口内数据包全部发送完毕，开始等待ACK
+            bool ackFlag = false;                                  // 当前超时期内是否收到ACK的标志
+            auto startTime = chrono::high_resolution_clock::now(); // 记录开始等待时间
+
+            // 等待ACK确认
+            while (!ackFlag)
             {
-                PDU ack = deserializePDU(recvBuf, ret);
+                // 检查超时
+                auto currentTime = chrono::high_resolution_clock::now();
+                auto elapsed = chrono::duration_cast<std::chrono::milliseconds>(currentTime - startTime);
 
-                // 若收到ACK，则更新窗口
-                if (ack.isValid())
+                // 超时处理：更新窗口位置，并发送窗口内所有未确认包
+                if (elapsed.count() >= timeout)
                 {
-                    ackFlag = true;                                            // 收到有效的ACK
-                    ackReceived = max(int(ack.seqNo), ackReceived);            // 更新已收到的最新ACK序列号
-                    seq = ackReceived + 1;                                     // 更新窗口的起始位置
-                    printProgressBar(ackReceived - initSeq + 1, totalPackets); // 打印进度条
+                    trace.record(TraceTimeout, ackReceived + 1, nextSeqNum);
+
+                    timeoutFlag = true;    // 设置超时标志
+                    seq = ackReceived + 1; // 更新窗口起始位置
+                    nextSeqNum = seq;      // 重置下一个要发送的包序列号
                     break;
                 }
-                else
-                    continue; // 无效的ACK，继续等待
+
+                // 未超时，接收 ACK：一次处理完已到达的全部 ACK，再用其中最新的累计确认采样 RTT
+                // 若每处理一个 ACK 就回去发包，后面的 ACK 在队列里等待的时间会被算进 RTT
+                uint32_t ackBefore = ackReceived;           // 本轮处理前的累计确认序号
+                chrono::steady_clock::time_point ackArrive; // 最新累计确认的到达时刻
+                pollAcks();
+                for (; !arrivedAcks.empty(); arrivedAcks.pop_front())
+                {
+                    vector<char> &buffer = arrivedAcks.front().second;
+                    PDU ack = aeadKey ? deserializeSealedPDU(buffer.data(), (int)buffer.size(), *aeadKey, AeadAck, aead.session) : deserializePDU(buffer.data(), (int)buffer.size());
+
+                    // 无效的ACK，继续读取；ACK 不携带数据，totalPackets 非 0 的是被反射回来的数据包
+                    if (!ack.isValid() || ack.totalPackets != 0)
+                        continue;
+
+                    ackFlag = true; // 收到有效的ACK
+
+                    // 更新已收到的最新ACK序列号
+                    if (seqLess(ackReceived, ack.seqNo))
+                    {
+                        ackReceived = ack.seqNo;
+                        ackArrive = arrivedAcks.front().first;
+                    }
+                    trace.record(TraceAck, ack.seqNo, ackReceived);
+
+                    // 解析 SACK 位图，第 i 位对应序号 ack.seqNo + 1 + i，只记录窗口内尚未确认的包
+                    // 位图超出窗口的部分直接忽略：接收方不会暂存窗口外的包，误标记会让这些包永远不被重传
+                    for (int i = 0; i < ack.length * 8 && i < swSize; ++i)
+                    {
+                        uint32_t sackSeq = ack.seqNo + 1 + i;
+                        if ((ack.data[i / 8] >> (i % 8) & 1) && seqLess(ackReceived, sackSeq) && seqLess(sackSeq, seq + swSize) && seqLess(sackSeq, endSeq))
+                            sacked[sackSeq] = 1;
+                    }
+                }
+                if (!ackFlag)
+                    continue;
+
+                // 本次新确认的包都只发送过一次时才采样 RTT（Karn 算法），并据此更新自适应发送速率
+                // 若中间有重传过的包，ACK 是被补上的空洞触发的，样本会把超时时间算进去
+                bool rttSample = seqLess(ackBefore, ackReceived) && seqLess(ackReceived, nextSeqNum);
+                for (uint32_t i = ackBefore + 1; rttSample && i != ackReceived + 1; ++i)
+                    rttSample = retransmitCount.get(i) == 1;
+                if (rttSample)
+                {
+                    double sample = chrono::duration<double>(ackArrive - sendTime.get(ackReceived)).count();
+                    srtt = srtt == 0 ? sample : 0.875 * srtt + 0.125 * sample;
+                    if (pacingEnable && pacingRate == 0)
+                        pacer.setRate(swSize * dataSize / srtt, dataSize);
+                }
+
+                // 更新窗口的起始位置
+                if (seq != ackReceived + 1)
+                    trace.record(TraceSlide, ackReceived + 1, seq);
+                seq = ackReceived + 1;
+
+                // 汇总各子流进度并打印进度条
+                {
+                    lock_guard<mutex> lock(consoleMutex);
+                    flowAcked[flowIdx] = ackReceived - initSeq + 1;
+                    int acked = 0;
+                    for (int i = 0; i < flowCount; ++i)
+                        acked += flowAcked[i];
+                    printProgressBar(min(acked, totalPackets), totalPackets);
+                }
+            }
+
+            // 全部包已确认，退出循环
+            if (ackReceived == endSeq - 1)
+            {
+                stat.done = true;
+                break;
             }
         }
 
-        // 全部包已确认，退出循环，打印统计信息
-        if (ackReceived >= totalPackets + initSeq - 1)
-        {
-            cout << "All packets acknowledged, exiting...\n";
+        log.close();
+        closesocket(sock);
+    };
 
-            auto senderEndTime = chrono::high_resolution_clock::now();
-            auto duration = chrono::duration_cast<chrono::seconds>(senderEndTime - senderStartTime).count();
-            cout << "\n[INFO] Total transmission time: " << duration << " s" << endl << endl;
+    cout << "totalPackets: " << totalPackets << ", flows: " << flowCount << endl;
+    cout << "Initialize success, preparing to send...\n\n";
+    printProgressBar(0, totalPackets);                           // 打印初始进度条
+    auto senderStartTime = chrono::high_resolution_clock::now(); // 记录发送开始时间
 
-            cout << "Total packets sent: " << totalSendCount << endl;
-            
-            cout << "Total Retransmissions: " << TOCount + RTCount << endl;
-            
-            cout << "Average Retransmissions: " << fixed << setprecision(2) << (double)(TOCount + RTCount) / totalPackets << endl;
+    // 每条子流一个发送线程
+    vector<thread> threads;
+    for (int i = 0; i < flowCount; ++i)
+        threads.emplace_back(sendFlow, i);
+    for (thread &t : threads)
+        t.join();
+
+    // 汇总各子流的统计信息
+    FlowStats total;
+    total.done = true;
+    for (const FlowStats &stat : stats)
+    {
+        total.TOCount += stat.TOCount;
+        total.RTCount += stat.RTCount;
+        total.totalSendCount += stat.totalSendCount;
+        total.SACKSkipCount += stat.SACKSkipCount;
+        total.done = total.done && stat.done;
+    }
 
-            cout << "Timeout Retransmissions: " << TOCount << " / " << totalSendCount << " = " << fixed << setprecision(2) << (double)TOCount / totalSendCount * 100 << "%" << endl;
+    // 全部包已确认，打印统计信息
+    if (total.done)
+    {
+        cout << "All packets acknowledged, exiting...\n";
 
-            cout << "Error or Lost Retransmissions: " << RTCount << " / " << totalSendCount<< " = " << fixed << setprecision(2) << (double)RTCount / totalSendCount * 100 << "%" << endl;
-            
-            break; // 退出循环
-        }
+        auto senderEndTime = chrono::high_resolution_clock::now();
+        auto duration = chrono::duration_cast<chrono::seconds>(senderEndTime - senderStartTime).count();
+        cout << "\n[INFO] Total transmission time: " << duration << " s" << endl << endl;
+
+        // 有效吞吐量：文件字节数 / 传输时间
+        double seconds = chrono::duration<double>(senderEndTime - senderStartTime).count();
+        cout << "Goodput: " << fixed << setprecision(2) << fileBytes / 1024 / seconds << " KB/s" << endl;
+
+        cout << "Total packets sent: " << total.totalSendCount << endl;
+
+        cout << "Total Retransmissions: " << total.TOCount + total.RTCount << endl;
+
+        cout << "Average Retransmissions: " << fixed << setprecision(2) << (double)(total.TOCount + total.RTCount) / totalPackets << endl;
+
+        cout << "Timeout Retransmissions: " << total.TOCount << " / " << total.totalSendCount << " = " << fixed << setprecision(2) << (double)total.TOCount / total.totalSendCount * 100 << "%" << endl;
+
+        cout << "Error or Lost Retransmissions: " << total.RTCount << " / " << total.totalSendCount << " = " << fixed << setprecision(2) << (double)total.RTCount / total.totalSendCount * 100 << "%" << endl;
+
+        cout << "SACK Skipped Retransmissions: " << total.SACKSkipCount << endl;
     }
+    else
+        cerr << "\nTransmission aborted.\n";
 
-    // 关闭socket并清理Winsock环境
-    log.close();
-    closesocket(sock);
+    // 清理Winsock环境
     WSACleanup();
     system("pause"); // 暂停，等待用户输入
-    return 0;
+    return total.done ? 0 : 1;
 }
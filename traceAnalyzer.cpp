@@ -0,0 +1,335 @@
+#include <algorithm>
+#include <memory>
+#include <queue>
+#include "proto.h"
+
+// 只读内存映射的追踪文件
+struct MappedTrace
+{
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+    const char *view = nullptr;
+    const TraceEvent *events = nullptr; // 文件头之后的定长记录
+    size_t count = 0;                   // 记录条数
+
+    // 映射追踪文件并校验文件头，失败返回 false
+    bool open(const string &path)
+    {
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || size.QuadPart < (LONGLONG)sizeof(TraceHeader))
+            return false;
+
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr)
+            return false;
+
+        view = (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (view == nullptr)
+            return false;
+
+        const TraceHeader *header = (const TraceHeader *)view;
+        if (memcmp(header->magic, "GBNT", 4) != 0 || header->recordSize != sizeof(TraceEvent))
+            return false;
+        if (header->version != TraceVersion)
+        {
+            cerr << "unsupported trace version " << header->version << ": " << path << endl;
+            return false;
+        }
+
+        events = (const TraceEvent *)(view + sizeof(TraceHeader));
+        count = (size.QuadPart - sizeof(TraceHeader)) / sizeof(TraceEvent);
+        return true;
+    }
+
+    MappedTrace() = default;
+    MappedTrace(const MappedTrace &) = delete;
+    MappedTrace &operator=(const MappedTrace &) = delete;
+    ~MappedTrace()
+    {
+        if (view)
+            UnmapViewOfFile(view);
+        if (mapping)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+    }
+};
+
+// 停顿原因
+enum StallCause
+{
+    StallLost,      // 窗口起点的包被丢弃
+    StallCorrupted, // 窗口起点的包校验失败
+    StallAck,       // 窗口起点的包已送达，但 ACK 丢失或迟到
+    StallNoTimeout, // 没有超时，ACK 推进缓慢
+    StallCauseCount
+};
+
+const char *stallCauseName[] = {"lost", "crc fail", "ack lost/late", "slow ack (no timeout)"};
+
+const char *traceTypeName[] = {"SEND", "ACK", "TIMEOUT", "SLIDE", "RECV", "CRC_FAIL", "WRITE"};
+
+const char *traceCodeName[] = {"NEW", "TO", "RT", "OK", "Buffered", "NoErr", "DataErr"};
+
+// 类型或状态码越界的记录视为损坏，分析时跳过
+bool validEvent(const TraceEvent &e)
+{
+    return e.type < sizeof(traceTypeName) / sizeof(traceTypeName[0]) && e.code < sizeof(traceCodeName) / sizeof(traceCodeName[0]);
+}
+
+// 取已排序数组的百分位数
+double percentile(const vector<double> &sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+    size_t index = static_cast<size_t>(p / 100 * (sorted.size() - 1));
+    return sorted[index];
+}
+
+// 返回路径所在目录（含末尾分隔符）
+string dirOf(const string &path)
+{
+    size_t slash = path.find_last_of("/\\");
+    return slash == string::npos ? "" : path.substr(0, slash + 1);
+}
+
+int main()
+{
+    // 加载配置文件
+    auto config = loadConfig("config.cfg");
+    int initSeq = stoi(config["InitSeqNo"]);
+    int timeout = stoi(config["Timeout"]);
+    int flowCount = configInt(config, "Flows", 1);
+
+    string sendTracePath = config["SendTracePath"];
+    string recvTracePath = config["RecvTracePath"];
+    string outputDir = dirOf(sendTracePath);
+
+    // 子流数至少为 1
+    if (flowCount < 1)
+    {
+        cerr << "Invalid Flows, expected a positive integer.\n";
+        return 1;
+    }
+
+    auto parseStart = chrono::steady_clock::now();
+
+    // 映射各子流的追踪文件，接收方追踪可缺省
+    vector<unique_ptr<MappedTrace>> senderTraces, receiverTraces;
+    for (int i = 0; i < flowCount; ++i)
+    {
+        senderTraces.emplace_back(new MappedTrace());
+        if (!senderTraces.back()->open(flowLogPath(sendTracePath, i, flowCount)))
+        {
+            cerr << "can't open sender_trace: " << flowLogPath(sendTracePath, i, flowCount) << endl;
+            return 1;
+        }
+
+        receiverTraces.emplace_back(new MappedTrace());
+        if (recvTracePath.empty() || !receiverTraces.back()->open(flowLogPath(recvTracePath, i, flowCount)))
+            receiverTraces.back().reset();
+    }
+
+    // 所有追踪文件，每个文件内部已按时间排序
+    vector<const MappedTrace *> traces;
+    size_t totalEvents = 0;
+    for (auto &t : senderTraces)
+        traces.push_back(t.get());
+    for (auto &t : receiverTraces)
+        if (t)
+            traces.push_back(t.get());
+    for (const MappedTrace *t : traces)
+        totalEvents += t->count;
+
+    int64_t t0 = INT64_MAX; // 最早的事件时间，作为时间轴零点
+    for (const MappedTrace *t : traces)
+        if (t->count > 0)
+            t0 = min(t0, t->events[0].timeNs);
+    if (totalEvents == 0)
+    {
+        cerr << "trace is empty" << endl;
+        return 1;
+    }
+
+    // 1. 时间线：多路归并所有追踪文件，按时间输出为 CSV，可直接用于绘图
+    size_t skippedEvents = 0; // 损坏而被跳过的记录数
+    {
+        ofstream csv(outputDir + "trace_timeline.csv");
+        csv << "time_ms,side,flow,event,seqNo,value,code\n";
+
+        typedef pair<int64_t, size_t> Head; // (时间, 追踪文件下标)
+        priority_queue<Head, vector<Head>, greater<Head>> heads;
+        vector<size_t> pos(traces.size(), 0);
+        for (size_t i = 0; i < traces.size(); ++i)
+            if (traces[i]->count > 0)
+                heads.push({traces[i]->events[0].timeNs, i});
+
+        char line[128];
+        while (!heads.empty())
+        {
+            size_t i = heads.top().second;
+            heads.pop();
+
+            const TraceEvent &e = traces[i]->events[pos[i]];
+            if (validEvent(e))
+            {
+                const char *side = i < senderTraces.size() ? "sender" : "receiver";
+                const char *code = e.type == TraceSend || e.type == TraceRecv || e.type == TraceCrcFail ? traceCodeName[e.code] : "";
+                snprintf(line, sizeof(line), "%.6f,%s,%u,%s,%u,%u,%s\n", (e.timeNs - t0) / 1e6, side, e.flow, traceTypeName[e.type], e.seqNo, e.value, code);
+                csv << line;
+            }
+            else
+                skippedEvents++;
+
+            if (++pos[i] < traces[i]->count)
+                heads.push({traces[i]->events[pos[i]].timeNs, i});
+        }
+    }
+
+    // 2. 发送方：逐包延迟（首次发送到被累计确认）与停顿归因
+    vector<double> latencies; // 每个包的延迟（毫秒）
+    double stallTime[StallCauseCount] = {};
+    int stallCount[StallCauseCount] = {};
+    int timeoutCount = 0;
+    {
+        ofstream csv(outputDir + "trace_latency.csv");
+        csv << "flow,seqNo,first_send_ms,acked_ms,latency_ms,sends\n";
+
+        int64_t stallThreshold = (int64_t)timeout * 1000000 / 2; // 窗口超过半个超时时间未推进视为停顿
+
+        for (const auto &t : senderTraces)
+        {
+            unordered_map<uint32_t, int64_t> firstSend; // 每个包的首次发送时间
+            unordered_map<uint32_t, int> sends;         // 每个包的发送次数
+            unordered_map<uint32_t, uint8_t> lastFate;  // 每个包最近一次发送的信道结果
+
+            uint32_t acked = uint32_t(initSeq) - 1; // 累计确认序号
+            int64_t lastProgress = t0;    // 窗口最近一次推进的时间
+            int64_t stallTimeout = -1;    // 本次停顿中首次超时的时间
+            StallCause cause = StallNoTimeout;
+
+            for (size_t k = 0; k < t->count; ++k)
+            {
+                const TraceEvent &e = t->events[k];
+                if (!validEvent(e))
+                    continue;
+                switch (e.type)
+                {
+                case TraceSend:
+                    if (!firstSend.count(e.seqNo))
+                        firstSend[e.seqNo] = e.timeNs;
+                    sends[e.seqNo]++;
+                    lastFate[e.seqNo] = e.value;
+                    break;
+
+                case TraceTimeout:
+                    timeoutCount++;
+                    // 按超时时窗口起点那个包最近一次发送的结果归因
+                    if (stallTimeout < 0)
+                    {
+                        stallTimeout = e.timeNs;
+                        auto fate = lastFate.find(e.seqNo);
+                        if (fate == lastFate.end() || fate->second == FateLost)
+                            cause = StallLost;
+                        else if (fate->second == FateCorrupted)
+                            cause = StallCorrupted;
+                        else
+                            cause = StallAck;
+                    }
+                    break;
+
+                case TraceAck:
+                    // 累计确认推进，为新确认的包计算延迟
+                    for (uint32_t s = acked + 1; seqLess(acked, e.value) && s != e.value + 1; ++s)
+                    {
+                        auto first = firstSend.find(s);
+                        if (first == firstSend.end())
+                            continue;
+
+                        double latency = (e.timeNs - first->second) / 1e6;
+                        latencies.push_back(latency);
+                        char line[128];
+                        snprintf(line, sizeof(line), "%u,%u,%.3f,%.3f,%.3f,%d\n", e.flow, s, (first->second - t0) / 1e6, (e.timeNs - t0) / 1e6, latency, sends[s]);
+                        csv << line;
+
+                        firstSend.erase(first);
+                        sends.erase(s);
+                        lastFate.erase(s);
+                    }
+                    if (seqLess(acked, e.value))
+                        acked = e.value;
+                    break;
+
+                case TraceSlide:
+                    // 窗口推进，若距上次推进过久则记为一次停顿
+                    if (e.timeNs - lastProgress >= stallThreshold)
+                    {
+                        StallCause c = stallTimeout >= 0 ? cause : StallNoTimeout;
+                        stallTime[c] += (e.timeNs - lastProgress) / 1e6;
+                        stallCount[c]++;
+                    }
+                    lastProgress = e.timeNs;
+                    stallTimeout = -1;
+                    break;
+                }
+            }
+        }
+    }
+
+    // 3. 有效吞吐量随时间变化：按 100ms 分桶统计接收方写入的字节数
+    const int64_t bucketNs = 100000000;
+    vector<double> bucketBytes;
+    for (const auto &t : receiverTraces)
+    {
+        if (!t)
+            continue;
+        for (size_t k = 0; k < t->count; ++k)
+        {
+            const TraceEvent &e = t->events[k];
+            if (!validEvent(e) || e.type != TraceWrite)
+                continue;
+            size_t bucket = (e.timeNs - t0) / bucketNs;
+            if (bucket >= bucketBytes.size())
+                bucketBytes.resize(bucket + 1, 0);
+            bucketBytes[bucket] += e.value;
+        }
+    }
+    if (!bucketBytes.empty())
+    {
+        ofstream csv(outputDir + "trace_goodput.csv");
+        csv << "time_ms,goodput_KBps\n";
+        for (size_t i = 0; i < bucketBytes.size(); ++i)
+            csv << i * 100 << "," << fixed << setprecision(2) << bucketBytes[i] / 1024 / 0.1 << "\n";
+    }
+
+    auto parseEnd = chrono::steady_clock::now();
+
+    // 打印汇总信息
+    sort(latencies.begin(), latencies.end());
+    cout << "Events analyzed: " << totalEvents << " in " << fixed << setprecision(3)
+         << chrono::duration<double>(parseEnd - parseStart).count() << " s" << endl;
+    if (skippedEvents > 0)
+        cout << "Skipped corrupt records: " << skippedEvents << endl;
+    cout << "Timeouts: " << timeoutCount << endl << endl;
+
+    cout << "Per-packet latency (ms), " << latencies.size() << " packets:" << endl;
+    cout << "  p50=" << percentile(latencies, 50) << "  p90=" << percentile(latencies, 90)
+         << "  p99=" << percentile(latencies, 99) << "  max=" << (latencies.empty() ? 0 : latencies.back()) << endl << endl;
+
+    cout << "Stall attribution (window idle >= " << timeout / 2 << " ms):" << endl;
+    for (int c = 0; c < StallCauseCount; ++c)
+        cout << "  " << left << setw(24) << stallCauseName[c] << right << setw(6) << stallCount[c] << " stalls, "
+             << setw(10) << stallTime[c] << " ms" << endl;
+
+    cout << endl << "Wrote " << outputDir << "trace_timeline.csv, trace_latency.csv";
+    if (!bucketBytes.empty())
+        cout << ", trace_goodput.csv";
+    cout << endl;
+
+    system("pause");
+    return 0;
+}